@@ -0,0 +1,241 @@
+/*
+ * qframechannel.cpp
+ *
+ * Description: Implementation for the QFrameChannel class
+ *
+ * This file is part of qframeclient.
+ *
+ * qframeclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * qframeclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with qframeclient. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Arno Willig
+ * Email: akw@thinkwiki.org
+ */
+
+#include "qframechannel.h"
+#include "qframeclient.h"
+
+#include <QJsonDocument>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QSet>
+#include <QWebSocket>
+
+#define FRAME_API_URL				"http://%1:8001/api/v2/"
+#define FRAME_ART_CHANNEL_URL			"ws://%1:8001/api/v2/channels/com.samsung.art-app?name=%2"
+#define D2D_SERVICE_MESSAGE_EVENT		"d2d_service_message"
+#define MS_CHANNEL_READY_EVENT			"ms.channel.ready"
+#define FRAME_CHANNEL_MAX_RELEASED_IDS		32
+
+#define FRAME_EVENT_ERROR			"error"
+#define FRAME_EVENT_READY_TO_USE		"ready_to_use"
+#define FRAME_EVENT_THUMBNAIL			"thumbnail"
+#define FRAME_EVENT_GET_PHOTO_FILTER_LIST	"get_photo_filter_list"
+#define FRAME_EVENT_MATTE_LIST			"matte_list"
+#define FRAME_EVENT_CONTENT_LIST		"content_list"
+#define FRAME_EVENT_CURRENT_ARTWORK		"current_artwork"
+#define FRAME_EVENT_API_VERSION			"api_version"
+#define FRAME_EVENT_GET_DEVICE_INFO		"get_device_info"
+#define FRAME_EVENT_ARTMODE_STATUS		"artmode_status"
+
+QHash<QString, QFrameChannel*> QFrameChannel::_sharedChannels;
+
+
+QFrameChannel::QFrameChannel(const QString& ipAddress, bool shared, QObject *parent) : QObject{parent}, _ipAddress(ipAddress), _shared(shared)
+{
+	_manager = new QNetworkAccessManager(this);
+	_websocket = new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this);
+	connect(_websocket, &QWebSocket::disconnected, this, [this]() {
+		_handshaking = false;
+		_ready = false;
+		emit disconnected();
+	});
+	connect(_websocket, QOverload<QAbstractSocket::SocketError>::of(&QWebSocket::error), this, [this]() {
+		if (_handshaking) {
+			qDebug("ERROR: '%s'", qPrintable(_websocket->errorString()));
+			_handshaking = false;
+			emit disconnected();
+		}
+	});
+	connect(_websocket, &QWebSocket::textMessageReceived, this, &QFrameChannel::messageReceived);
+}
+
+QFrameChannel::~QFrameChannel()
+{
+	_websocket->close();
+	delete _websocket;
+	delete _manager;
+}
+
+QFrameChannel* QFrameChannel::acquire(const QString& ipAddress, QFrameClient* client, bool shared)
+{
+	QFrameChannel* channel = shared ? _sharedChannels.value(ipAddress) : nullptr;
+	if (!channel) {
+		channel = new QFrameChannel(ipAddress, shared);
+		if (shared) {
+			_sharedChannels.insert(ipAddress, channel);
+		}
+	}
+	channel->_clients.insert(client->_uuid, client);
+	channel->_releasedIds.removeAll(client->_uuid);
+	return channel;
+}
+
+void QFrameChannel::release(QFrameClient* client)
+{
+	_clients.remove(client->_uuid);
+	// Remember the last released ids to drop replies still in flight for them
+	_releasedIds.append(client->_uuid);
+	while (_releasedIds.size() > FRAME_CHANNEL_MAX_RELEASED_IDS) {
+		_releasedIds.removeFirst();
+	}
+	if (!_clients.isEmpty()) {
+		return;
+	}
+	if (_shared && _sharedChannels.value(_ipAddress) == this) {
+		_sharedChannels.remove(_ipAddress);
+	}
+	disconnect(_websocket, nullptr, this, nullptr);
+	_websocket->close();
+	deleteLater();
+}
+
+void QFrameChannel::decodeMessage(const QString& message, QVariantMap& map, QVariantMap& dataMap)
+{
+	map = QJsonDocument::fromJson(message.toUtf8()).toVariant().toMap();
+	if (map.value("event").toString() == D2D_SERVICE_MESSAGE_EVENT) {
+		dataMap = QJsonDocument::fromJson(map.value("data").toString().toUtf8()).toVariant().toMap();
+	} else {
+		dataMap.clear();
+	}
+}
+
+QString QFrameChannel::ipAddress() const
+{
+	return _ipAddress;
+}
+
+bool QFrameChannel::isShared() const
+{
+	return _shared;
+}
+
+bool QFrameChannel::isValid() const
+{
+	return _websocket->isValid();
+}
+
+bool QFrameChannel::isReady() const
+{
+	return _ready;
+}
+
+QVariantMap QFrameChannel::deviceInfo() const
+{
+	return _deviceInfo;
+}
+
+void QFrameChannel::open(const QString& clientName)
+{
+	if (_handshaking || _ready) {
+		return;
+	}
+	_handshaking = true;
+	getRestApiInfo(clientName);
+}
+
+void QFrameChannel::sendTextMessage(const QByteArray& packet)
+{
+	_websocket->sendTextMessage(packet);
+}
+
+void QFrameChannel::getRestApiInfo(const QString& clientName)
+{
+	QNetworkReply* reply = _manager->get(QNetworkRequest(QUrl(QStringLiteral(FRAME_API_URL).arg(_ipAddress))));
+	connect(reply, &QNetworkReply::finished, this, [this, reply, clientName]() {
+		reply->deleteLater();
+		if (reply->error() != QNetworkReply::NoError) {
+			qDebug("ERROR: '%s' '%s'", qPrintable(reply->errorString()), qPrintable(reply->request().url().toString()));
+			_handshaking = false;
+			emit disconnected();
+			return;
+		}
+		QByteArray ba = reply->readAll();
+		reply->close();
+		QVariantMap map = QJsonDocument::fromJson(ba).toVariant().toMap();
+		QVariantMap supportMap = QJsonDocument::fromJson(map.value("isSupport").toString().toUtf8()).toVariant().toMap();
+		_deviceInfo = map.value("device").toMap();
+		_deviceInfo.insert("support", supportMap);
+		_deviceInfo.insert("version", map.value("version").toString());
+		qDebug("RestApiInfo: %s", QJsonDocument::fromVariant(_deviceInfo).toJson(QJsonDocument::Indented).constData());
+		emit deviceInfoChanged();
+		_websocket->open(QUrl(QString(FRAME_ART_CHANNEL_URL).arg(_ipAddress, clientName)));
+	});
+}
+
+// Answers to a single client's request; everything else is a state change
+// that all clients need to see.
+bool QFrameChannel::isQueryReply(const QString& evt)
+{
+	static const QSet<QString> replies{
+		FRAME_EVENT_ERROR, FRAME_EVENT_READY_TO_USE, FRAME_EVENT_THUMBNAIL,
+		FRAME_EVENT_GET_PHOTO_FILTER_LIST, FRAME_EVENT_MATTE_LIST, FRAME_EVENT_CONTENT_LIST,
+		FRAME_EVENT_CURRENT_ARTWORK, FRAME_EVENT_API_VERSION, FRAME_EVENT_GET_DEVICE_INFO,
+		FRAME_EVENT_ARTMODE_STATUS
+	};
+	return replies.contains(evt);
+}
+
+void QFrameChannel::messageReceived(const QString& message)
+{
+	QVariantMap map;
+	QVariantMap dataMap;
+	decodeMessage(message, map, dataMap);
+
+	if (map.value("event").toString() == MS_CHANNEL_READY_EVENT) {
+		_handshaking = false;
+		_ready = true;
+	}
+
+	// Query replies carry the id of the client that issued the request. Replies
+	// to clients that have released the channel in the meantime are dropped.
+	QString id = dataMap.value("id").toString();
+	if (!id.isEmpty() && isQueryReply(dataMap.value("event").toString())) {
+		QFrameClient* target = _clients.value(id);
+		if (target) {
+			target->dispatchMessage(message, map, dataMap, true);
+			return;
+		}
+		if (_releasedIds.contains(id)) {
+			return;
+		}
+	}
+
+	// One client performs the side effects of an event towards the TV,
+	// preferably one that is able to send Wake-On-LAN packets
+	const QList<QString> ids = _clients.keys();
+	QString primaryId = ids.value(0);
+	for (const QString& clientId : ids) {
+		if (_clients.value(clientId)->hasValidMacAddress()) {
+			primaryId = clientId;
+			break;
+		}
+	}
+	// Clients may detach or be deleted while an event is being dispatched
+	for (const QString& clientId : ids) {
+		QFrameClient* client = _clients.value(clientId);
+		if (client) {
+			client->dispatchMessage(message, map, dataMap, clientId == primaryId);
+		}
+	}
+}
@@ -0,0 +1,79 @@
+/*
+ * qframechannel.h
+ *
+ * Description: Header for the QFrameChannel class
+ *
+ * This file is part of qframeclient.
+ *
+ * qframeclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * qframeclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with qframeclient. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Arno Willig
+ * Email: akw@thinkwiki.org
+ */
+
+#ifndef FRAMECHANNEL_H
+#define FRAMECHANNEL_H
+
+#include <QObject>
+#include <QHash>
+#include <QStringList>
+#include <QVariantMap>
+
+class QNetworkAccessManager;
+class QWebSocket;
+class QFrameClient;
+
+// The art-app websocket and REST handshake towards one TV. A shared channel
+// is used by all clients with the same IP address; query replies are routed
+// to the client whose id is in the reply, events are broadcast.
+class QFrameChannel : public QObject
+{
+	Q_OBJECT
+public:
+	static QFrameChannel* acquire(const QString& ipAddress, QFrameClient* client, bool shared);
+	void release(QFrameClient* client);
+	static void decodeMessage(const QString& message, QVariantMap& map, QVariantMap& dataMap);
+	QString ipAddress() const;
+	bool isShared() const;
+	bool isValid() const;
+	bool isReady() const;
+	QVariantMap deviceInfo() const;
+	void open(const QString& clientName);
+	void sendTextMessage(const QByteArray& packet);
+signals:
+	void deviceInfoChanged();
+	void disconnected();
+private slots:
+	void messageReceived(const QString& message);
+
+private:
+	explicit QFrameChannel(const QString& ipAddress, bool shared, QObject *parent = nullptr);
+	virtual ~QFrameChannel();
+	void getRestApiInfo(const QString& clientName);
+	static bool isQueryReply(const QString& evt);
+
+	static QHash<QString, QFrameChannel*> _sharedChannels;
+
+	QNetworkAccessManager* _manager = nullptr;
+	QWebSocket* _websocket = nullptr;
+	QHash<QString, QFrameClient*> _clients;
+	QStringList _releasedIds;
+	QString _ipAddress;
+	QVariantMap _deviceInfo;
+	bool _shared      = false;
+	bool _handshaking = false;
+	bool _ready       = false;
+};
+
+#endif // FRAMECHANNEL_H
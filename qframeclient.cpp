@@ -23,22 +23,23 @@
  */
 
 #include "qframeclient.h"
+#include "qframechannel.h"
+#include "qframetrace.h"
 
 #include <QDebug>
 #include <QDir>
 #include <QFile>
 #include <QJsonDocument>
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
 #include <QRandomGenerator>
+#include <QRegExp>
+#include <QTcpSocket>
 #include <QThread>
 #include <QUdpSocket>
 #include <QtEndian>
-#include <QWebSocket>
+#include <QUuid>
 #ifdef QT_QUICK_LIB
 #include <QtQml>
 #endif
-#define FRAME_API_URL				"http://%1:8001/api/v2/"
 #define D2D_SERVICE_MESSAGE_EVENT		"d2d_service_message"
 #define MS_CHANNEL_CONNECT_EVENT		"ms.channel.connect"
 #define MS_CHANNEL_READY_EVENT			"ms.channel.ready"
@@ -73,19 +74,12 @@
 QFrameClient::QFrameClient(QObject *parent) : QObject{parent}
 {
 	_uuid = QUuid::createUuid().toString(QUuid::WithoutBraces);
-	_manager = new QNetworkAccessManager(this);
-	_websocket = new QWebSocket(QString(), QWebSocketProtocol::VersionLatest, this);
-	// connect(_websocket, &QWebSocket::connected,    this, [this]() { emit connectedChanged(true);  });
-	connect(_websocket, &QWebSocket::disconnected, this, [this]() { emit connectedChanged(false); });
-	connect(_websocket, &QWebSocket::textMessageReceived, this, &QFrameClient::messageReceived);
 	QDir().mkpath(tempPath());
 }
 
 QFrameClient::~QFrameClient()
 {
 	disconnectFromFrame();
-	delete _websocket;
-	delete _manager;
 }
 
 #ifdef QT_QUICK_LIB
@@ -100,6 +94,10 @@ void QFrameClient::connectToFrame()
 	if (_connecting) {
 		return;
 	}
+	if (_replay) {
+		qDebug("ERROR: Cannot connect while a trace is replayed");
+		return;
+	}
 	if (ipAddress().isEmpty()) {
 		_wantToConnect = true;
 		return;
@@ -113,12 +111,12 @@ void QFrameClient::connectToFrame()
 void QFrameClient::disconnectFromFrame()
 {
 	_connecting = false;
-	_websocket->close();
+	detachChannel();
 }
 
 bool QFrameClient::isConnected() const
 {
-	return _websocket->isValid();
+	return _channel && _channel->isValid();
 }
 
 void QFrameClient::setConnected(bool connected)
@@ -132,11 +130,11 @@ void QFrameClient::setConnected(bool connected)
 
 void QFrameClient::sendWakeOnLanPacket()
 {
-	QString macAddr = macAddress();
-	macAddr.remove(QRegExp("[^A-Fa-f0-9]"));
-	if (macAddr.length() != 12) {
+	if (_replay || !hasValidMacAddress()) {
 		return;
 	}
+	QString macAddr = macAddress();
+	macAddr.remove(QRegExp("[^A-Fa-f0-9]"));
 	QByteArray macBytes = QByteArray::fromHex(macAddr.toUtf8());
 	QByteArray magicPacket(6, 0xff);
 	for (int i = 0; i < 16; ++i) {
@@ -145,32 +143,78 @@ void QFrameClient::sendWakeOnLanPacket()
 	QUdpSocket().writeDatagram(magicPacket, QHostAddress::Broadcast, 9);
 }
 
+bool QFrameClient::hasValidMacAddress() const
+{
+	QString macAddr = macAddress();
+	macAddr.remove(QRegExp("[^A-Fa-f0-9]"));
+	return macAddr.length() == 12;
+}
+
 void QFrameClient::getRestApiInfo()
 {
-	QNetworkReply* reply = _manager->get(QNetworkRequest(QUrl(QStringLiteral(FRAME_API_URL).arg(ipAddress()))));
-	connect(reply, &QNetworkReply::finished,[this, reply]() {
-		if (reply->error() != QNetworkReply::NoError) {
-			qDebug("ERROR: '%s' '%s'", qPrintable(reply->errorString()), qPrintable(reply->request().url().toString()));
-			_connecting = false;
-			return;
-		}
-		QByteArray ba = reply->readAll();
-		reply->close();
-		reply->deleteLater();
-		QVariantMap map = QJsonDocument::fromJson(ba).toVariant().toMap();
-		QVariantMap supportMap = QJsonDocument::fromJson(map.value("isSupport").toString().toUtf8()).toVariant().toMap();
-		_deviceInfo = map.value("device").toMap();
-		_deviceInfo.insert("support", supportMap);
-		_deviceInfo.insert("version", map.value("version").toString());
-		qDebug("RestApiInfo: %s", QJsonDocument::fromVariant(_deviceInfo).toJson(QJsonDocument::Indented).constData());
+	attachChannel();
+	if (_channel->isReady()) {
+		channelReady();
+	} else {
+		_channel->open(clientName());
+	}
+}
+
+void QFrameClient::attachChannel()
+{
+	if (_channel && (_channel->ipAddress() != ipAddress() || _channel->isShared() != _sharedConnection)) {
+		detachChannel();
+	}
+	if (_channel) {
+		return;
+	}
+	_channel = QFrameChannel::acquire(ipAddress(), this, _sharedConnection);
+	connect(_channel, &QFrameChannel::disconnected, this, [this]() {
+		_connecting = false;
+		clearPendingUpload();
+		emit connectedChanged(false);
+	});
+	connect(_channel, &QFrameChannel::deviceInfoChanged, this, [this]() {
+		_deviceInfo = _channel->deviceInfo();
 		emit deviceInfoChanged();
-		_websocket->open(QUrl(QString("ws://%1:8001/api/v2/channels/com.samsung.art-app?name=%2").arg(ipAddress(), clientName())));
 	});
+	if (!_channel->deviceInfo().isEmpty()) {
+		_deviceInfo = _channel->deviceInfo();
+		emit deviceInfoChanged();
+	}
+}
+
+void QFrameClient::detachChannel()
+{
+	if (!_channel) {
+		return;
+	}
+	bool wasConnected = _channel->isValid();
+	disconnect(_channel, nullptr, this, nullptr);
+	_channel->release(this);
+	clearPendingUpload();
+	_channel = nullptr;
+	if (wasConnected) {
+		emit connectedChanged(false);
+	}
+}
+
+void QFrameClient::channelReady()
+{
+	getApiVersion();
+	getDeviceInfo();
+	getArtModeStatus();
+
+	_connecting = false;
+	emit connectedChanged(true);
 }
 
 void QFrameClient::sendArtRequest(const QVariantMap& requestMap)
 {
-	if (!_websocket->isValid()) {
+	if (_replay) {
+		return;
+	}
+	if (!isConnected()) {
 		return;
 	}
 	QVariantMap dataMap = requestMap;
@@ -180,12 +224,18 @@ void QFrameClient::sendArtRequest(const QVariantMap& requestMap)
 	map["params"] = QVariantMap{ {"event", "art_app_request"}, {"to", "host"}, {"data", QJsonDocument::fromVariant(dataMap).toJson(QJsonDocument::Compact)}};
 	QByteArray packet = QJsonDocument::fromVariant(map).toJson(QJsonDocument::Compact);
 	// qDebug("Sending: %s", packet.constData());
-	_websocket->sendTextMessage(packet);
+	if (_trace) {
+		_trace->record(QFrameTrace::MessageSent, packet);
+	}
+	_channel->sendTextMessage(packet);
 }
 
 // matte = "none", "shadowbox_black"
 void QFrameClient::uploadImage(const QString& fileName, const QString& matte)
 {
+	if (!isConnected()) {
+		return;
+	}
 	QFile f(fileName);
 	if (!f.open(QIODevice::ReadOnly)) {
 		return;
@@ -197,11 +247,15 @@ void QFrameClient::uploadImage(const QString& fileName, const QString& matte)
 	QString date = QDateTime::currentDateTime().toString("yyyy:MM:dd hh:mm:ss");
 	quint32 connId = QRandomGenerator::global()->bounded(std::numeric_limits<quint32>::min(), std::numeric_limits<quint32>::max());
 	QVariantMap connInfo{{"d2d_mode", "socket"}, {"connection_id", connId}, {"id", _uuid}};
+	_uploadConnectionId = connId;
 	sendArtRequest(QVariantMap{{"request", "send_image"},{"file_type", "jpg"},{"conn_info", connInfo}, {"image_date", date}, {"matte_id", matte}, {"file_size", fileSize}});
 }
 
 void QFrameClient::uploadImage(const QString& ip, quint16 port, const QString& key, const QByteArray& payload)
 {
+	if (_replay) {
+		return;
+	}
 	QVariantMap hdMap;
 	hdMap["num"]        = 0;
 	hdMap["total"]      = 1;
@@ -216,12 +270,42 @@ void QFrameClient::uploadImage(const QString& ip, quint16 port, const QString& k
 	data.append(QByteArray((const char*) &headerLen, 4));
 	data.append(hdData);
 	data.append(payload);
+	if (_trace) {
+		_trace->record(QFrameTrace::D2DSent, data, ++_traceSocketId);
+	}
 	QTcpSocket* sock = new QTcpSocket(this);
+	quint32 connId = _uploadConnectionId;
 	connect(sock, &QTcpSocket::connected, sock, [sock, data]() { sock->write(data); sock->close(); });
 	connect(sock, &QTcpSocket::disconnected, sock, &QObject::deleteLater);
+	connect(sock, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error), this, [this, sock, connId]() {
+		qDebug("ERROR: Upload failed: '%s'", qPrintable(sock->errorString()));
+		if (_uploadConnectionId == connId) {
+			clearPendingUpload();
+		}
+		sock->deleteLater();
+	});
 	sock->connectToHost(ip, port);
 }
 
+// On a private channel every upload event belongs to this client, on a shared
+// channel only those matching the pending upload's connection id do.
+bool QFrameClient::ownsUpload(const QVariantMap& connInfo) const
+{
+	if (!_channel || !_channel->isShared()) {
+		return true;
+	}
+	if (_uploadConnectionId == 0) {
+		return false;
+	}
+	return !connInfo.contains("connection_id") || connInfo.value("connection_id").toLongLong() == _uploadConnectionId;
+}
+
+void QFrameClient::clearPendingUpload()
+{
+	_uploadData.clear();
+	_uploadConnectionId = 0;
+}
+
 QString QFrameClient::tempPath() const
 {
 	return QDir::tempPath() + "/qframeclient";
@@ -230,13 +314,27 @@ QString QFrameClient::tempPath() const
 void QFrameClient::socketReadyRead()
 {
 	QTcpSocket* sock = qobject_cast<QTcpSocket*>(sender());
+	QByteArray chunk = sock->readAll();
+	if (_trace) {
+		_trace->record(QFrameTrace::D2DReceived, chunk, sock->property("traceId").toUInt());
+	}
 	QByteArray thumbData = sock->property("thumbData").toByteArray();
-	thumbData.append(sock->readAll());
+	thumbData.append(chunk);
 	sock->setProperty("thumbData", thumbData);
+	if (parseThumbnailData(thumbData)) {
+		sock->close();
+	}
+}
+
+bool QFrameClient::parseThumbnailData(const QByteArray& thumbData)
+{
+	if (thumbData.size() < 4) {
+		return false;
+	}
 	quint32 headerLen = qFromBigEndian(*((quint32*)thumbData.left(4).constBegin()));
 	int payloadStart = 4 + headerLen;
 	if (thumbData.size() < payloadStart) {
-		return;
+		return false;
 	}
 	QVariantMap headerMap = QJsonDocument::fromJson(thumbData.mid(4, headerLen)).toVariant().toMap();
 	QString fileName = headerMap.value("fileName").toString();
@@ -249,7 +347,7 @@ void QFrameClient::socketReadyRead()
 
 	int completeSize = payloadStart + fileLength;
 	if (thumbData.size() < completeSize) {
-		return;
+		return false;
 	}
 	// qDebug("headerMap: %s", QJsonDocument::fromVariant(headerMap).toJson().constData());
 	QByteArray imgData = thumbData.mid(4 + headerLen, fileLength);
@@ -260,14 +358,18 @@ void QFrameClient::socketReadyRead()
 		f.write(imgData);
 		f.close();
 	}
-	sock->close();
 	emit gotThumbnail(fileID, imagePath);
+	return true;
 }
 
 void QFrameClient::readThumbnail(const QString& ip, quint16 port)
 {
+	if (_replay) {
+		return;
+	}
 	QTcpSocket* sock = new QTcpSocket(this);
 	sock->setProperty("thumbData", QByteArray());
+	sock->setProperty("traceId", ++_traceSocketId);
 	connect(sock, &QTcpSocket::readyRead,    this, &QFrameClient::socketReadyRead);
 	connect(sock, &QTcpSocket::disconnected, sock, &QObject::deleteLater);
 	sock->connectToHost(ip, port);
@@ -337,7 +439,17 @@ void QFrameClient::setArtModeStatus(bool artModeStatus)
 
 void QFrameClient::messageReceived(const QString &message)
 {
-	QVariantMap map = QJsonDocument::fromJson(message.toUtf8()).toVariant().toMap();
+	QVariantMap map;
+	QVariantMap dataMap;
+	QFrameChannel::decodeMessage(message, map, dataMap);
+	dispatchMessage(message, map, dataMap);
+}
+
+void QFrameClient::dispatchMessage(const QString& message, const QVariantMap& map, const QVariantMap& dataMap, bool primary)
+{
+	if (_trace) {
+		_trace->record(QFrameTrace::MessageReceived, message.toUtf8());
+	}
 	QString evt = map.value("event").toString();
 
 	if (evt == MS_CHANNEL_CONNECT_EVENT) {
@@ -345,15 +457,11 @@ void QFrameClient::messageReceived(const QString &message)
 		// qDebug("%s", QJsonDocument::fromVariant(map).toJson().constData());
 	} else if (evt == MS_CHANNEL_READY_EVENT) {
 		qDebug("Frame Event: '%s'", qPrintable(evt));
-		getApiVersion();
-		getDeviceInfo();
-		getArtModeStatus();
-
-		_connecting = false;
-		emit connectedChanged(true);
+		if (_channel) {
+			channelReady();
+		}
 
 	} else if (evt == D2D_SERVICE_MESSAGE_EVENT) {
-		QVariantMap dataMap = QJsonDocument::fromJson(map.value("data").toString().toUtf8()).toVariant().toMap();
 		QString evt = dataMap.value("event").toString();
 		if (evt == FRAME_EVENT_ARTMODE_STATUS) {
 			QString val = dataMap.value("value").toString();
@@ -417,14 +525,17 @@ void QFrameClient::messageReceived(const QString &message)
 			QString key  = connInfo.value("key").toString();
 			quint16 port = connInfo.value("port").toInt();
 			qDebug("Frame Event: ready_to_use: '%s:%d' SecKey: '%s'", qPrintable(ip), port, qPrintable(key));
-			uploadImage(ip, port, key, _uploadData);
+			if (ownsUpload(connInfo)) {
+				uploadImage(ip, port, key, _uploadData);
+			}
 		} else if (evt == FRAME_EVENT_IMAGE_ADDED) {
 			// qDebug("DATA: %s", QJsonDocument::fromVariant(dataMap).toJson().constData());
 			QString categoryId = dataMap.value("category_id").toString();
 			QString contentId = dataMap.value("content_id").toString();
 
 			qDebug("Frame Event: image_added: '%s', '%s'", qPrintable(categoryId), qPrintable(contentId));
-			if (categoryId.isEmpty()) {
+			if (categoryId.isEmpty() && ownsUpload(QVariantMap())) {
+				clearPendingUpload();
 				selectImage(contentId, categoryId);
 				emit imageUploadFinished(contentId);
 			}
@@ -440,9 +551,14 @@ void QFrameClient::messageReceived(const QString &message)
 			QString errCode = dataMap.value("error_code").toString();
 			QVariantMap reqData = QJsonDocument::fromJson(dataMap.value("request_data").toString().toUtf8()).toVariant().toMap();
 			qDebug("Frame Event: error: '%s' %s", qPrintable(errCode), QJsonDocument::fromVariant(reqData).toJson().constData());
+			if (reqData.value("request").toString() == "send_image") {
+				clearPendingUpload();
+			}
 		} else if (evt == FRAME_EVENT_GO_TO_STANDBY) {
 			qDebug("Frame Event: '%s'", qPrintable(evt));
-			sendWakeOnLanPacket();
+			if (primary) {
+				sendWakeOnLanPacket();
+			}
 		} else {
 			qDebug("Frame Event: '%s'", qPrintable(evt));
 			qDebug("DATA: %s", QJsonDocument::fromVariant(dataMap).toJson().constData());
@@ -515,3 +631,44 @@ QString QFrameClient::frameName() const
 {
 	return _deviceInfo.value("name").toString();
 }
+
+QString QFrameClient::traceFile() const
+{
+	return _traceFile;
+}
+
+void QFrameClient::setTraceFile(const QString& traceFile)
+{
+	if (_traceFile == traceFile) {
+		return;
+	}
+	QString previousTraceFile = _traceFile;
+	delete _trace;
+	_trace = nullptr;
+	_traceFile.clear();
+	if (!traceFile.isEmpty()) {
+		_trace = new QFrameTrace(this);
+		if (_trace->open(traceFile)) {
+			_traceFile = traceFile;
+		} else {
+			delete _trace;
+			_trace = nullptr;
+		}
+	}
+	if (_traceFile != previousTraceFile) {
+		emit traceFileChanged();
+	}
+}
+
+bool QFrameClient::sharedConnection() const
+{
+	return _sharedConnection;
+}
+
+void QFrameClient::setSharedConnection(bool sharedConnection)
+{
+	if (_sharedConnection != sharedConnection) {
+		_sharedConnection = sharedConnection;
+		emit sharedConnectionChanged();
+	}
+}
@@ -26,10 +26,12 @@
 #define FRAMECLIENT_H
 
 #include <QObject>
+#include <QPointer>
 #include <QVariantMap>
 
-class QNetworkAccessManager;
-class QWebSocket;
+class QFrameChannel;
+class QFrameTrace;
+class QFrameTraceReplay;
 
 class QFrameClient : public QObject
 {
@@ -42,6 +44,8 @@ class QFrameClient : public QObject
 	Q_PROPERTY(bool connected      READ isConnected   WRITE setConnected     NOTIFY connectedChanged)
 	Q_PROPERTY(bool artModeStatus  READ artModeStatus WRITE setArtModeStatus NOTIFY artModeStatusChanged)
 	Q_PROPERTY(bool frameTVSupport READ hasFrameTVSupport                    NOTIFY deviceInfoChanged)
+	Q_PROPERTY(QString traceFile   READ traceFile     WRITE setTraceFile     NOTIFY traceFileChanged)
+	Q_PROPERTY(bool sharedConnection READ sharedConnection WRITE setSharedConnection NOTIFY sharedConnectionChanged)
 public:
 	explicit QFrameClient(QObject *parent = nullptr);
 	virtual ~QFrameClient();
@@ -61,6 +65,10 @@ public:
 	QVariantMap deviceInfo() const;
 	bool hasFrameTVSupport() const;
 	QString frameName() const;
+	QString traceFile() const;
+	void setTraceFile(const QString& traceFile);
+	bool sharedConnection() const;
+	void setSharedConnection(bool sharedConnection);
 public slots:
 	void connectToFrame();
 	void disconnectFromFrame();
@@ -79,13 +87,14 @@ public slots:
 	void getThumbnail(const QString& contentId);
 	void changeMatte(const QString &contentId, const QString &matteId);
 private slots:
-	void messageReceived(const QString& message);
 	void socketReadyRead();
 	void sendArtRequest(const QVariantMap& dataMap);
 signals:
 	void macAddressChanged();
 	void ipAddressChanged();
 	void clientNameChanged();
+	void traceFileChanged();
+	void sharedConnectionChanged();
 	void connectedChanged(bool connected);
 	void gotDeviceInfo(const QVariantMap& deviceInfo);
 	void gotApiVersion(const QString& apiVersion);
@@ -98,21 +107,37 @@ signals:
 	void imagesDeleted(const QStringList& contentIdList);
 
 private:
+	friend class QFrameChannel;
+	friend class QFrameTraceReplay;
+	void attachChannel();
+	void detachChannel();
+	void channelReady();
+	void messageReceived(const QString& message);
+	void dispatchMessage(const QString& message, const QVariantMap& map, const QVariantMap& dataMap, bool primary = true);
+	bool hasValidMacAddress() const;
+	bool ownsUpload(const QVariantMap& connInfo) const;
+	void clearPendingUpload();
+	bool parseThumbnailData(const QByteArray& thumbData);
 	void readThumbnail(const QString& ip, quint16 port);
 	void uploadImage(const QString& ip, quint16 port, const QString& key, const QByteArray& payload);
 	QString tempPath() const;
 
-	QNetworkAccessManager* _manager = nullptr;
-	QWebSocket* _websocket = nullptr;
+	QFrameChannel* _channel = nullptr;
+	QFrameTrace* _trace = nullptr;
+	QPointer<QFrameTraceReplay> _replay;
+	quint32 _traceSocketId = 0;
 	QByteArray _uploadData;
+	quint32 _uploadConnectionId = 0;
 	QString _uuid;
 	QString _macAddress;
 	QString _ipAddress;
 	QString _clientName;
+	QString _traceFile;
 	QVariantMap _deviceInfo;
 	bool _artModeStatus = true;
 	bool _connecting    = false;
 	bool _wantToConnect = false;
+	bool _sharedConnection = false;
 };
 
 #endif // FRAMECLIENT_H
@@ -1,6 +1,6 @@
 QT = gui quick core network websockets
 CONFIG += c++11 console
-SOURCES += main.cpp qframeclient.cpp
-HEADERS += qframeclient.h
+SOURCES += main.cpp qframeclient.cpp qframechannel.cpp qframetrace.cpp
+HEADERS += qframeclient.h qframechannel.h qframetrace.h
 RESOURCES += resources.qrc
 OTHER_FILES += LICENSE README.md
@@ -0,0 +1,257 @@
+/*
+ * qframetrace.cpp
+ *
+ * Description: Implementation for the QFrameTrace and QFrameTraceReplay classes
+ *
+ * This file is part of qframeclient.
+ *
+ * qframeclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * qframeclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with qframeclient. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Arno Willig
+ * Email: akw@thinkwiki.org
+ */
+
+#include "qframetrace.h"
+#include "qframeclient.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QTimer>
+
+// File layout: magic, version, then records of
+// (quint32 msecs since previous record, quint8 type, quint32 channel, QByteArray data)
+#define FRAME_TRACE_MAGIC			0x51465452 // "QFTR"
+#define FRAME_TRACE_VERSION			1
+#define FRAME_TRACE_STREAM_VERSION		QDataStream::Qt_5_0
+
+
+QFrameTrace::QFrameTrace(QObject *parent) : QObject{parent}
+{
+}
+
+QFrameTrace::~QFrameTrace()
+{
+	close();
+}
+
+bool QFrameTrace::open(const QString& fileName)
+{
+	close();
+	_file = new QFile(fileName);
+	if (!_file->open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		qDebug("ERROR: Cannot open trace file '%s': %s", qPrintable(fileName), qPrintable(_file->errorString()));
+		delete _file;
+		_file = nullptr;
+		return false;
+	}
+	QDataStream out(_file);
+	out.setVersion(FRAME_TRACE_STREAM_VERSION);
+	out << quint32(FRAME_TRACE_MAGIC) << quint16(FRAME_TRACE_VERSION);
+	_lastTimestamp = 0;
+	_timer.start();
+	return true;
+}
+
+void QFrameTrace::close()
+{
+	if (_file) {
+		_file->close();
+		delete _file;
+		_file = nullptr;
+	}
+}
+
+bool QFrameTrace::isOpen() const
+{
+	return _file != nullptr;
+}
+
+QString QFrameTrace::fileName() const
+{
+	return _file ? _file->fileName() : QString();
+}
+
+void QFrameTrace::record(RecordType type, const QByteArray& data, quint32 channel)
+{
+	if (!_file) {
+		return;
+	}
+	qint64 timestamp = _timer.elapsed();
+	quint32 delta = quint32(qMin<qint64>(timestamp - _lastTimestamp, 0xffffffff));
+	_lastTimestamp = timestamp;
+	QDataStream out(_file);
+	out.setVersion(FRAME_TRACE_STREAM_VERSION);
+	out << delta << quint8(type) << channel << data;
+	// Keep the trace usable if the process dies
+	_file->flush();
+}
+
+QList<QFrameTrace::Record> QFrameTrace::load(const QString& fileName, bool* ok)
+{
+	QList<Record> records;
+	if (ok) {
+		*ok = false;
+	}
+	QFile f(fileName);
+	if (!f.open(QIODevice::ReadOnly)) {
+		qDebug("ERROR: Cannot open trace file '%s': %s", qPrintable(fileName), qPrintable(f.errorString()));
+		return records;
+	}
+	QDataStream in(&f);
+	in.setVersion(FRAME_TRACE_STREAM_VERSION);
+	quint32 magic = 0;
+	quint16 version = 0;
+	in >> magic >> version;
+	if (magic != FRAME_TRACE_MAGIC || version != FRAME_TRACE_VERSION) {
+		qDebug("ERROR: '%s' is not a trace file", qPrintable(fileName));
+		return records;
+	}
+	qint64 timestamp = 0;
+	while (!in.atEnd()) {
+		quint32 delta = 0;
+		quint8 type = 0;
+		Record rec;
+		in >> delta >> type >> rec.channel >> rec.data;
+		if (in.status() != QDataStream::Ok) {
+			qDebug("ERROR: Truncated trace file '%s' after %d records", qPrintable(fileName), records.size());
+			break;
+		}
+		timestamp += delta;
+		rec.timestamp = timestamp;
+		rec.type = RecordType(type);
+		records.append(rec);
+	}
+	if (ok) {
+		*ok = true;
+	}
+	return records;
+}
+
+
+QFrameTraceReplay::QFrameTraceReplay(QFrameClient* client, QObject *parent) : QObject{parent}, _client(client)
+{
+	_timer = new QTimer(this);
+	_timer->setSingleShot(true);
+	connect(_timer, &QTimer::timeout, this, &QFrameTraceReplay::replayNext);
+	if (!client) {
+		return;
+	}
+	connect(client, &QObject::destroyed, this, &QFrameTraceReplay::stop);
+}
+
+QFrameTraceReplay::~QFrameTraceReplay()
+{
+	stop();
+}
+
+bool QFrameTraceReplay::load(const QString& fileName)
+{
+	stop();
+	bool ok = false;
+	_records = QFrameTrace::load(fileName, &ok);
+	return ok;
+}
+
+int QFrameTraceReplay::recordCount() const
+{
+	return _records.size();
+}
+
+bool QFrameTraceReplay::isRunning() const
+{
+	return _running;
+}
+
+bool QFrameTraceReplay::start(qreal speed)
+{
+	stop();
+	if (!_client) {
+		return false;
+	}
+	// Replayed and live frames must not mix, and a live TV must not be changed
+	if (_client->isConnected() || _client->_channel) {
+		qDebug("ERROR: Cannot replay a trace into a connected client");
+		return false;
+	}
+	if (_client->_replay) {
+		qDebug("ERROR: Client is already replaying a trace");
+		return false;
+	}
+	_speed = speed;
+	_pos = 0;
+	_running = true;
+	_client->_replay = this;
+	_clock.start();
+	replayNext();
+	return true;
+}
+
+void QFrameTraceReplay::stop()
+{
+	_timer->stop();
+	_d2dBuffers.clear();
+	if (_running) {
+		_running = false;
+		if (_client && _client->_replay == this) {
+			_client->_replay = nullptr;
+		}
+	}
+}
+
+void QFrameTraceReplay::replayNext()
+{
+	while (_running && _pos < _records.size()) {
+		if (!_client) {
+			stop();
+			return;
+		}
+		const QFrameTrace::Record& rec = _records.at(_pos);
+		if (_speed > 0) {
+			qint64 due = qint64(rec.timestamp / _speed);
+			qint64 now = _clock.elapsed();
+			if (due > now) {
+				_timer->start(int(due - now));
+				return;
+			}
+		}
+		++_pos;
+		dispatch(rec);
+	}
+	if (_running) {
+		qint64 elapsed = _clock.elapsed();
+		stop();
+		emit finished(elapsed);
+	}
+}
+
+void QFrameTraceReplay::dispatch(const QFrameTrace::Record& record)
+{
+	switch (record.type) {
+	case QFrameTrace::MessageReceived:
+		_client->messageReceived(QString::fromUtf8(record.data));
+		break;
+	case QFrameTrace::D2DReceived: {
+		QByteArray& buffer = _d2dBuffers[record.channel];
+		buffer.append(record.data);
+		if (_client->parseThumbnailData(buffer)) {
+			_d2dBuffers.remove(record.channel);
+		}
+		break;
+	}
+	case QFrameTrace::MessageSent:
+	case QFrameTrace::D2DSent:
+		// Outgoing traffic is regenerated by the client itself
+		break;
+	}
+}
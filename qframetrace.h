@@ -0,0 +1,106 @@
+/*
+ * qframetrace.h
+ *
+ * Description: Header for the QFrameTrace and QFrameTraceReplay classes
+ *
+ * This file is part of qframeclient.
+ *
+ * qframeclient is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * qframeclient is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with qframeclient. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Author: Arno Willig
+ * Email: akw@thinkwiki.org
+ */
+
+#ifndef FRAMETRACE_H
+#define FRAMETRACE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QPointer>
+
+class QFile;
+class QTimer;
+class QFrameClient;
+
+// Records the websocket frames and D2D socket transfers of a QFrameClient
+// to a compact binary trace file.
+class QFrameTrace : public QObject
+{
+	Q_OBJECT
+public:
+	enum RecordType : quint8 {
+		MessageReceived = 0, // websocket frame from the TV
+		MessageSent     = 1, // websocket frame to the TV
+		D2DReceived     = 2, // D2D socket data from the TV
+		D2DSent         = 3  // D2D socket data to the TV
+	};
+	Q_ENUM(RecordType)
+
+	struct Record {
+		qint64 timestamp = 0; // msecs since start of recording
+		RecordType type  = MessageReceived;
+		quint32 channel  = 0; // 0 for the websocket, D2D socket id otherwise
+		QByteArray data;
+	};
+
+	explicit QFrameTrace(QObject *parent = nullptr);
+	virtual ~QFrameTrace();
+	bool open(const QString& fileName);
+	void close();
+	bool isOpen() const;
+	QString fileName() const;
+	void record(RecordType type, const QByteArray& data, quint32 channel = 0);
+	static QList<Record> load(const QString& fileName, bool* ok = nullptr);
+
+private:
+	QFile* _file = nullptr;
+	QElapsedTimer _timer;
+	qint64 _lastTimestamp = 0;
+};
+
+// Feeds a recorded trace back into a QFrameClient at original or accelerated speed.
+class QFrameTraceReplay : public QObject
+{
+	Q_OBJECT
+public:
+	explicit QFrameTraceReplay(QFrameClient* client, QObject *parent = nullptr);
+	virtual ~QFrameTraceReplay();
+	bool load(const QString& fileName);
+	int recordCount() const;
+	bool isRunning() const;
+public slots:
+	bool start(qreal speed = 1.0); // speed <= 0 replays as fast as possible
+	void stop();
+signals:
+	void finished(qint64 elapsed);
+private slots:
+	void replayNext();
+
+private:
+	void dispatch(const QFrameTrace::Record& record);
+
+	QPointer<QFrameClient> _client;
+	QTimer* _timer = nullptr;
+	QList<QFrameTrace::Record> _records;
+	QHash<quint32, QByteArray> _d2dBuffers;
+	QElapsedTimer _clock;
+	qreal _speed = 1.0;
+	int _pos = 0;
+	bool _running = false;
+};
+
+#endif // FRAMETRACE_H